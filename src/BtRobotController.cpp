@@ -8,6 +8,7 @@
 #include "esp_bt.h"
 #include "esp_log.h"
 #include "esp_assert.h"
+#include "esp_timer.h"
 #include <functional>
 
 #include <string.h>
@@ -20,6 +21,21 @@ uint32_t BtRobotController::ReadDataLen = 0;
 uint8_t BtRobotController::WriteData[BTROBOT_MAX_DATA_LEN] = {0};
 uint32_t BtRobotController::WriteDataLen = 0;
 
+// UUIDs only depend on the slot, so they are built at compile time.
+#define BTROBOT_CHR_UUID(id) BLE_UUID128_INIT(0x3f, 0xd3, 0x2b, 0xe3, 0xad, 0x57, 0x4f, 0x3a, 0xad, 0xca, 0xb9, 0x3f, 0x14, 0x79, 0x86, id)
+#define BTROBOT_DSC_UUID(dsc, id) BLE_UUID128_INIT(0x3f, 0xd3, 0x2b, 0xe3, 0xad, 0x57, 0x4f, 0x3a, 0xad, 0xca, 0xb9, 0x3f, 0x14, 0x79, dsc, id)
+#define BTROBOT_DSC_UUIDS(id) {BTROBOT_DSC_UUID(0, id), BTROBOT_DSC_UUID(1, id), BTROBOT_DSC_UUID(2, id), BTROBOT_DSC_UUID(3, id), BTROBOT_DSC_UUID(4, id)}
+
+static_assert(BTROBOT_CONFIG_MAX_CHARS == 10 && BTROBOT_CONFIG_MAX_DESCRIPTORS == 5, "Update the UUID tables");
+
+const ble_uuid128_t BtRobotController::CHARACTERISTIC_UUID[BTROBOT_CONFIG_MAX_CHARS] = {
+    BTROBOT_CHR_UUID(0), BTROBOT_CHR_UUID(1), BTROBOT_CHR_UUID(2), BTROBOT_CHR_UUID(3), BTROBOT_CHR_UUID(4),
+    BTROBOT_CHR_UUID(5), BTROBOT_CHR_UUID(6), BTROBOT_CHR_UUID(7), BTROBOT_CHR_UUID(8), BTROBOT_CHR_UUID(9)};
+
+const ble_uuid128_t BtRobotController::DESCRIPTORS_UUID[BTROBOT_CONFIG_MAX_CHARS][BTROBOT_CONFIG_MAX_DESCRIPTORS] = {
+    BTROBOT_DSC_UUIDS(0), BTROBOT_DSC_UUIDS(1), BTROBOT_DSC_UUIDS(2), BTROBOT_DSC_UUIDS(3), BTROBOT_DSC_UUIDS(4),
+    BTROBOT_DSC_UUIDS(5), BTROBOT_DSC_UUIDS(6), BTROBOT_DSC_UUIDS(7), BTROBOT_DSC_UUIDS(8), BTROBOT_DSC_UUIDS(9)};
+
 BtRobotController &BtRobotController::getBtRobotController()
 {
     static BtRobotController instance;
@@ -28,19 +44,12 @@ BtRobotController &BtRobotController::getBtRobotController()
 
 BtRobotController::BtRobotController()
 {
-    lastCharacteristic = 0x00;
 }
 
 void BtRobotController::Init(char *robotName, struct BtRobotConfiguration btServicesConfig[], uint32_t lenServicesConfig)
 {
-    ESP_LOGI(TAG, "Robot: %p", this);
-    // >= due to the last item being the {0}
-    if (lenServicesConfig >= BTROBOT_CONFIG_MAX_CHARS)
-    {
-        ESP_LOGE(TAG, "Error Maximum characterics are %d, provided: %lu", BTROBOT_CONFIG_MAX_CHARS, lenServicesConfig);
-        return;
-    }
-
+    startupTiming.initStart = esp_timer_get_time();
+    ESP_LOGD(TAG, "Robot: %p", this);
     // Handle robot Name
     if (strlen(robotName) > BTROBOT_ROBOTNAME_MAXLEN - 1)
     {
@@ -49,12 +58,12 @@ void BtRobotController::Init(char *robotName, struct BtRobotConfiguration btServ
     }
     strcpy(internalRobotName, robotName);
 
-    ESP_LOGI(TAG, "Starting Filling chars..");
+    ESP_LOGD(TAG, "Starting Filling chars..");
 
     static const ble_uuid128_t userService = BLE_UUID128_INIT(0x0f, 0x4b, 0xe0, 0x8b, 0x89, 0x3c, 0x40, 0x97, 0xa3, 0xc5, 0x5e, 0x7c, 0xfc, 0xd2, 0x73, 0x70);   //"0f4be08b-893c-4097-a3c5-5e7cfcd27370"
     static const ble_uuid128_t configService = BLE_UUID128_INIT(0x0a, 0x4b, 0xe0, 0x8b, 0x89, 0x3c, 0x40, 0x97, 0xa3, 0xc5, 0x5e, 0x7c, 0xfc, 0xd2, 0x73, 0x70); //"0a4be08b-893c-4097-a3c5-5e7cfcd27370"
 
-    static const ble_uuid128_t configChrNames BLE_UUID128_INIT(0x3f, 0xd3, 0x2b, 0xe3, 0xad, 0x57, 0x4f, 0x3a, 0xad, 0xca, 0xb9, 0x3f, 0x14, 0x79, 0x08, lastCharacteristic);
+    static const ble_uuid128_t configChrNames BLE_UUID128_INIT(0x3f, 0xd3, 0x2b, 0xe3, 0xad, 0x57, 0x4f, 0x3a, 0xad, 0xca, 0xb9, 0x3f, 0x14, 0x79, 0x08, 0x00);
 
     // Configuration service
     memset(commonCharacteristics, 0, BTROBOT_CONFIG_MAX_CHARS * sizeof(ble_gatt_chr_def));
@@ -63,9 +72,9 @@ void BtRobotController::Init(char *robotName, struct BtRobotConfiguration btServ
         .access_cb = &BtRobotController::configCallback,
         .arg = (void *)1,
         .descriptors = nullptr,
-        .flags = BLE_GATT_CHR_F_READ,
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
         .min_key_size = 16,
-        .val_handle = nullptr};
+        .val_handle = &configNamesHandle};
 
     gatt_svcs[0] = {
         .type = BLE_GATT_SVC_TYPE_PRIMARY,
@@ -84,20 +93,10 @@ void BtRobotController::Init(char *robotName, struct BtRobotConfiguration btServ
     gatt_svcs[2] = {};
     gatt_svcs[2].uuid = 0;
 
-    numUserCharacteristics = lenServicesConfig;
-
-    // Generate Bluetooth's Structure for user characteristics
-    for (uint32_t i = 0; i < lenServicesConfig; i++)
+    // Every slot is registered, whatever the configuration, so the attribute table never changes
+    // and Reconfigure() can swap the configuration with the connections up.
+    for (uint32_t i = 0; i < BTROBOT_CONFIG_MAX_CHARS - 1; i++)
     {
-        // Store locally
-        // userConfigurations[i] = btServicesConfig[i];
-        if (strlen(btServicesConfig[i].paramName) < BTROBOT_CONFIG_NAME_MAXLEN)
-        {
-            strcpy(characteristicNames[i], btServicesConfig[i].paramName);
-        }
-
-        ESP_LOGE(TAG, "Adding characteristic %lu, cb: %p", i, btServicesConfig[i].callback);
-        generateUUID();
         userCharacteristics[i] =
             {
                 .uuid = &(CHARACTERISTIC_UUID[i].u),
@@ -117,40 +116,151 @@ void BtRobotController::Init(char *robotName, struct BtRobotConfiguration btServ
             .access_cb = &BtRobotController::typeCallback,
             .arg = (void *)i,
         };
-        userConfiguration[i].dataConfig = btServicesConfig[i].dataConfig;
-
-        callbackMap[i] = btServicesConfig[i].callback;
     }
 
-    userCharacteristics[lenServicesConfig] = {};
-    userCharacteristics[lenServicesConfig].uuid = NULL;
+    userCharacteristics[BTROBOT_CONFIG_MAX_CHARS - 1] = {};
+    userCharacteristics[BTROBOT_CONFIG_MAX_CHARS - 1].uuid = NULL;
+
+    if (!buildUserTables(btServicesConfig, lenServicesConfig))
+    {
+        return;
+    }
+    applyUserTables();
 
     gatt_svcs[1].characteristics = userCharacteristics;
+    startupTiming.gattTableSetup = esp_timer_get_time();
 
     internalBtInit();
+    startupTiming.nimbleInitDone = esp_timer_get_time();
+
+    // Before the host task starts, so the first advertisement already goes out at maximum power.
+    configure_ble_max_power();
+    startupTiming.txPowerSet = esp_timer_get_time();
+
     ble_gatts_count_cfg(gatt_svcs); // config all the gatt services that wanted to be used.
     ble_gatts_add_svcs(gatt_svcs);  // queues all services.
+    startupTiming.gattRegistered = esp_timer_get_time();
 
     ble_hs_cfg.sync_cb = BtRobotController::ble_app_on_sync;
+    ble_npl_event_init(&reconfigureEvent, BtRobotController::reconfigureEventCb, nullptr);
 
     nimble_port_freertos_init(BtRobotController::host_task);
+}
 
-    configure_ble_max_power();
+bool BtRobotController::Reconfigure(struct BtRobotConfiguration btServicesConfig[], uint32_t lenServicesConfig)
+{
+    if (!ble_hs_synced())
+    {
+        ESP_LOGE(TAG, "Error Reconfigure called before the BLE host is ready");
+        return false;
+    }
+
+    // Taken before touching pendingTables, released by the host task once they are applied.
+    bool expected = false;
+    if (!reconfigurePending.compare_exchange_strong(expected, true))
+    {
+        ESP_LOGE(TAG, "Error Reconfigure already in progress");
+        return false;
+    }
+
+    reconfigureStart = esp_timer_get_time();
+
+    // Built here, in the caller's task, the host task only has to swap them in.
+    if (!buildUserTables(btServicesConfig, lenServicesConfig))
+    {
+        reconfigurePending = false;
+        return false;
+    }
+
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &reconfigureEvent);
+    return true;
 }
 
-ble_uuid128_t BtRobotController::generateUUID()
+bool BtRobotController::buildUserTables(struct BtRobotConfiguration btServicesConfig[], uint32_t lenServicesConfig)
 {
-    CHARACTERISTIC_UUID[lastCharacteristic] =
-        BLE_UUID128_INIT(0x3f, 0xd3, 0x2b, 0xe3, 0xad, 0x57, 0x4f, 0x3a, 0xad, 0xca, 0xb9, 0x3f, 0x14, 0x79, 0x86, lastCharacteristic);
+    // >= due to the last item being the {0}
+    if (lenServicesConfig >= BTROBOT_CONFIG_MAX_CHARS)
+    {
+        ESP_LOGE(TAG, "Error Maximum characterics are %d, provided: %lu", BTROBOT_CONFIG_MAX_CHARS, lenServicesConfig);
+        return false;
+    }
 
-    for (uint8_t i = 0; i < BTROBOT_CONFIG_MAX_DESCRIPTORS; i++)
+    memset(&pendingTables, 0, sizeof(pendingTables));
+    pendingTables.numUserCharacteristics = lenServicesConfig;
+
+    for (uint32_t i = 0; i < lenServicesConfig; i++)
     {
-        DESCRIPTORS_UUID[lastCharacteristic][i] =
-            BLE_UUID128_INIT(0x3f, 0xd3, 0x2b, 0xe3, 0xad, 0x57, 0x4f, 0x3a, 0xad, 0xca, 0xb9, 0x3f, 0x14, 0x79, i, lastCharacteristic);
+        if (strlen(btServicesConfig[i].paramName) < BTROBOT_CONFIG_NAME_MAXLEN)
+        {
+            strcpy(pendingTables.characteristicNames[i], btServicesConfig[i].paramName);
+        }
+
+        ESP_LOGD(TAG, "Adding characteristic %lu, cb: %p", i, btServicesConfig[i].callback);
+        pendingTables.dataConfig[i] = btServicesConfig[i].dataConfig;
+        pendingTables.callbackMap[i] = btServicesConfig[i].callback;
+    }
+
+    return true;
+}
+
+void BtRobotController::applyUserTables()
+{
+    numUserCharacteristics = pendingTables.numUserCharacteristics;
+    memcpy(characteristicNames, pendingTables.characteristicNames, sizeof(characteristicNames));
+    memcpy(callbackMap, pendingTables.callbackMap, sizeof(callbackMap));
+
+    for (uint32_t i = 0; i < BTROBOT_CONFIG_MAX_CHARS; i++)
+    {
+        userConfiguration[i].dataConfig = pendingTables.dataConfig[i];
+    }
+}
+
+void BtRobotController::reconfigureEventCb(struct ble_npl_event *ev)
+{
+    BtRobotController &controller = BtRobotController::getBtRobotController();
+
+    // Runs in the host task, so no GATT access can happen while the tables are swapped.
+    controller.applyUserTables();
+
+    // Connected apps subscribed to the names are notified directly, bonded peers get Service Changed.
+    ble_gatts_chr_updated(controller.configNamesHandle);
+    ble_svc_gatt_changed(0x0001, 0xFFFF);
+
+    int64_t elapsed = esp_timer_get_time() - controller.reconfigureStart;
+    ESP_LOGI(TAG, "Reconfigured to %d characteristics in %lld us", controller.numUserCharacteristics, elapsed);
+
+    // Last, a new Reconfigure() may start as soon as this is cleared.
+    controller.reconfigurePending = false;
+}
+
+bool BtRobotController::getStartupTiming(struct BtRobotStartupTiming &timing) const
+{
+    if (!startupTimingComplete)
+    {
+        return false;
     }
 
-    lastCharacteristic++;
-    return CHARACTERISTIC_UUID[lastCharacteristic];
+    timing = startupTiming;
+    return true;
+}
+
+void BtRobotController::logStartupTiming()
+{
+    struct BtRobotStartupTiming t;
+    if (!getStartupTiming(t))
+    {
+        ESP_LOGW(TAG, "Startup timing not complete yet");
+        return;
+    }
+
+    ESP_LOGI(TAG, "Startup timing (us since boot / phase duration):");
+    ESP_LOGI(TAG, "  Init start        %8lld", t.initStart);
+    ESP_LOGI(TAG, "  GATT table setup  %8lld / %8lld", t.gattTableSetup, t.gattTableSetup - t.initStart);
+    ESP_LOGI(TAG, "  nimble_port_init  %8lld / %8lld", t.nimbleInitDone, t.nimbleInitDone - t.gattTableSetup);
+    ESP_LOGI(TAG, "  TX power          %8lld / %8lld", t.txPowerSet, t.txPowerSet - t.nimbleInitDone);
+    ESP_LOGI(TAG, "  GATT registration %8lld / %8lld", t.gattRegistered, t.gattRegistered - t.txPowerSet);
+    ESP_LOGI(TAG, "  Host sync         %8lld / %8lld", t.hostSynced, t.hostSynced - t.gattRegistered);
+    ESP_LOGI(TAG, "  First advertising %8lld / %8lld", t.firstAdvertising, t.firstAdvertising - t.hostSynced);
 }
 
 void BtRobotController::internalBtInit()
@@ -186,6 +296,12 @@ int BtRobotController::commonCallback(uint16_t conn_handle, uint16_t attr_handle
     uint32_t id = (int)arg;
 
     ESP_LOGI(TAG, "Callback arg: %d\n", (int)arg);
+    if (id >= controller.numUserCharacteristics)
+    {
+        // Slot not used by the current configuration.
+        return ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR ? BLE_ATT_ERR_WRITE_NOT_PERMITTED : BLE_ATT_ERR_READ_NOT_PERMITTED;
+    }
+
     uint8_t om_len;
     switch (ctxt->op)
     {
@@ -229,6 +345,7 @@ int BtRobotController::configCallback(uint16_t conn_handle, uint16_t attr_handle
         *configDataPointer = ';';
         configDataPointer++;
     }
+    *configDataPointer = '\0';
     //  "NOMBRE_1§Nombre_2§Nombre_3§": (len(nombre) + 1 )*numChar
 
     switch (ctxt->op)
@@ -264,6 +381,11 @@ int BtRobotController::typeCallback(uint16_t conn_handle, uint16_t attr_handle,
     }
     ESP_LOGI(TAG,"End Data: \n");
 */
+    if (id >= controller.numUserCharacteristics)
+    {
+        return BLE_ATT_ERR_READ_NOT_PERMITTED;
+    }
+
     switch (ctxt->op)
     {
     case BLE_GATT_ACCESS_OP_READ_DSC:
@@ -315,7 +437,15 @@ void BtRobotController::ble_app_advertise(void)
     memset(&adv_params, 0, sizeof(adv_params));
     adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
     adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
-    ble_gap_adv_start(ble_addr_type, NULL, BLE_HS_FOREVER, &adv_params, BtRobotController::ble_gap_event, NULL);
+    int rc = ble_gap_adv_start(ble_addr_type, NULL, BLE_HS_FOREVER, &adv_params, BtRobotController::ble_gap_event, NULL);
+
+    BtRobotController &controller = BtRobotController::getBtRobotController();
+    if (rc == 0 && controller.startupTiming.firstAdvertising == 0)
+    {
+        controller.startupTiming.firstAdvertising = esp_timer_get_time();
+        // Set last, the application only reads the timing once this is true.
+        controller.startupTimingComplete = true;
+    }
 }
 
 
@@ -394,6 +524,11 @@ void BtRobotController::ble_app_on_sync(void)
     // ble_addr_t addr;
     // ble_hs_id_gen_rnd(1, &addr);
     // ble_hs_id_set_rnd(addr.val);
+    BtRobotController &controller = BtRobotController::getBtRobotController();
+    if (controller.startupTiming.hostSynced == 0)
+    {
+        controller.startupTiming.hostSynced = esp_timer_get_time();
+    }
     ble_hs_id_infer_auto(0, &ble_addr_type); // determines automatic address.
     BtRobotController::ble_app_advertise();  // start advertising the services -->
 }
@@ -414,7 +549,7 @@ void BtRobotController::configure_ble_max_power()
     result = esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_CONN_HDL0, ESP_PWR_LVL_P7);
     if (result == ESP_OK)
     {
-        ESP_LOGI("power", "Configured ESP_BLE_PWR_TYPE_CONN_HDL0 to maximum");
+        ESP_LOGD("power", "Configured ESP_BLE_PWR_TYPE_CONN_HDL0 to maximum");
     }
     else
     {
@@ -424,7 +559,7 @@ void BtRobotController::configure_ble_max_power()
     result = esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_CONN_HDL1, ESP_PWR_LVL_P7);
     if (result == ESP_OK)
     {
-        ESP_LOGI("power", "Configured ESP_BLE_PWR_TYPE_CONN_HDL1 to maximum");
+        ESP_LOGD("power", "Configured ESP_BLE_PWR_TYPE_CONN_HDL1 to maximum");
     }
     else
     {
@@ -437,7 +572,7 @@ void BtRobotController::configure_ble_max_power()
     result = esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_ADV, ESP_PWR_LVL_P7);
     if (result == ESP_OK)
     {
-        ESP_LOGI("power", "Configured ESP_BLE_PWR_TYPE_ADV to maximum");
+        ESP_LOGD("power", "Configured ESP_BLE_PWR_TYPE_ADV to maximum");
     }
     else
     {
@@ -448,7 +583,7 @@ void BtRobotController::configure_ble_max_power()
     result = esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_SCAN, ESP_PWR_LVL_P7);
     if (result == ESP_OK)
     {
-        ESP_LOGI("power", "Configured ESP_BLE_PWR_TYPE_SCAN to maximum");
+        ESP_LOGD("power", "Configured ESP_BLE_PWR_TYPE_SCAN to maximum");
     }
     else
     {
@@ -459,7 +594,7 @@ void BtRobotController::configure_ble_max_power()
     result = esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_DEFAULT, ESP_PWR_LVL_P7);
     if (result == ESP_OK)
     {
-        ESP_LOGI("power", "Configured ESP_BLE_PWR_TYPE_DEFAULT to maximum");
+        ESP_LOGD("power", "Configured ESP_BLE_PWR_TYPE_DEFAULT to maximum");
     }
     else
     {
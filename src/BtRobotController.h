@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <atomic>
 
 #include "nimble/nimble_port.h"
 #include "nimble/nimble_port_freertos.h"
@@ -65,6 +66,21 @@ struct dataType
     } config;
 };
 
+/**
+ * Timestamps (in us since boot, from esp_timer_get_time()) of every startup phase.
+ * A phase that has not been reached yet is 0.
+ */
+struct BtRobotStartupTiming
+{
+    int64_t initStart;
+    int64_t gattTableSetup;
+    int64_t nimbleInitDone;
+    int64_t txPowerSet;
+    int64_t gattRegistered;
+    int64_t hostSynced;
+    int64_t firstAdvertising;
+};
+
 struct BtRobotConfiguration
 {
     char paramName[BTROBOT_CONFIG_NAME_MAXLEN];
@@ -87,6 +103,18 @@ public:
      */
     void Init(char *robotName, struct BtRobotConfiguration btServicesConfig[], uint32_t lenServicesConfig);
 
+    /**
+     * @brief Replace the configuration/actions at runtime, without rebooting. Shall be called after Init, once
+     *  the robot is advertising. The swap itself is done asynchronously in the BLE host task.
+     *  All the characteristic slots are always registered, so the connections stay up. The names
+     *  characteristic is notified so connected apps read the new configuration, and a Service Changed
+     *  indication is sent for bonded peers.
+     * @param btServicesConfig A list of the required configuration/actions.
+     * @param lenServicesConfig Number of configurations in 'btServicesConfig'
+     * @return true if the new configuration was accepted, false if it is invalid or another one is in progress.
+     */
+    bool Reconfigure(struct BtRobotConfiguration btServicesConfig[], uint32_t lenServicesConfig);
+
     /**
      * @brief A helper function to run a callback. This function is used by a static one and *should not be* used by
      *  the user of the library.
@@ -100,6 +128,19 @@ public:
 
     static void data_op_read(void *data, uint32_t len);
 
+    /**
+     * @brief Copy the timing of the startup phases, filled by Init and the BLE host.
+     * @param timing Where the timing is copied.
+     * @return false (and 'timing' untouched) until the first advertisement has been started.
+     */
+    bool getStartupTiming(struct BtRobotStartupTiming &timing) const;
+
+    /**
+     * @brief Log the startup timing report, once complete. Called by the application, it is not done
+     *  automatically to keep the logs out of the BLE host task.
+     */
+    void logStartupTiming();
+
     struct BtRobotConfiguration userConfiguration[BTROBOT_CONFIG_MAX_CHARS] = {};
 
     uint8_t numUserCharacteristics;
@@ -130,15 +171,38 @@ private:
     char internalRobotName[BTROBOT_ROBOTNAME_MAXLEN];
 
     /***** BLE Items *****/
-    uint8_t lastCharacteristic;
-
     // last svc is {0}
     struct ble_gatt_svc_def gatt_svcs[3];
     struct ble_gatt_chr_def commonCharacteristics[BTROBOT_CONFIG_MAX_CHARS] = {};
     struct ble_gatt_chr_def userCharacteristics[BTROBOT_CONFIG_MAX_CHARS] = {};
     struct ble_gatt_dsc_def userDescriptors[BTROBOT_CONFIG_MAX_CHARS][BTROBOT_CONFIG_MAX_DESCRIPTORS] = {};
 
-    ble_uuid128_t generateUUID();
+    /***** Reconfiguration *****/
+
+    // User configuration, built before being copied into the live tables.
+    struct UserTables
+    {
+        uint8_t numUserCharacteristics;
+        char characteristicNames[BTROBOT_CONFIG_MAX_CHARS][BTROBOT_CONFIG_NAME_MAXLEN];
+        struct dataType dataConfig[BTROBOT_CONFIG_MAX_CHARS];
+        robotUserCallbackFn callbackMap[BTROBOT_CONFIG_MAX_CHARS];
+    };
+    struct UserTables pendingTables = {};
+
+    struct ble_npl_event reconfigureEvent;
+    std::atomic<bool> reconfigurePending{false};
+    int64_t reconfigureStart = 0;
+
+    // Value handle of the names characteristic, notified when the configuration changes.
+    uint16_t configNamesHandle = 0;
+
+    bool buildUserTables(struct BtRobotConfiguration btServicesConfig[], uint32_t lenServicesConfig);
+    void applyUserTables();
+    static void reconfigureEventCb(struct ble_npl_event *ev);
+
+    /***** Startup timing *****/
+    struct BtRobotStartupTiming startupTiming = {};
+    std::atomic<bool> startupTimingComplete{false};
 
     /*******************************/
     /* Callbacks                  */
@@ -159,8 +223,8 @@ private:
     /* Characteristics UUIDs       */
     /*******************************/
 
-    ble_uuid128_t CHARACTERISTIC_UUID[BTROBOT_CONFIG_MAX_CHARS];
-    ble_uuid128_t DESCRIPTORS_UUID[BTROBOT_CONFIG_MAX_CHARS][BTROBOT_CONFIG_MAX_DESCRIPTORS];
+    static const ble_uuid128_t CHARACTERISTIC_UUID[BTROBOT_CONFIG_MAX_CHARS];
+    static const ble_uuid128_t DESCRIPTORS_UUID[BTROBOT_CONFIG_MAX_CHARS][BTROBOT_CONFIG_MAX_DESCRIPTORS];
 
     struct BtRobotConfiguration userConfigurations[BTROBOT_CONFIG_MAX_CHARS];
 